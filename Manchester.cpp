@@ -31,20 +31,81 @@ static int8_t RxPin = 255;
 volatile static int16_t rx_sample = 0;
 volatile static int16_t rx_last_sample = 0;
 volatile static uint8_t rx_count = 0;
+volatile static uint8_t rx_step = 8; //rx_count increment per sample
 volatile static uint8_t rx_sync_count = 0;
 volatile static uint8_t rx_mode = RX_MODE_IDLE;
 
+volatile static uint8_t rx_cs_enabled = 0; //sample the channel even when not receiving
+volatile static uint8_t rx_cs_count = 0; //samples since the last transition
+volatile static uint8_t rx_cs_max = MaxLongCount >> 3; //longest valid pulse in samples
+volatile static uint8_t rx_cs_slowest = 0; //slowest speed sensed, as a shift from the timer speed
+volatile static uint8_t rx_cs_speed = 0; //speed picked by the first pulse of a run
+volatile static uint8_t rx_cs_pulses = 0; //consecutive transitions with a valid pulse width
+
 static uint16_t rx_manBits = 0; //the received manchester 32 bits
 static uint8_t rx_numMB = 0; //the number of received manchester bits
-static uint8_t rx_curByte = 0;
-
-static uint8_t rx_maxBytes = 2;
+static uint16_t rx_curByte = 0;
+static uint16_t rx_pn9 = PN9_SEED; //whitening sequence state
+
+// link quality of the packet being received, taken from the pulse widths
+static uint16_t rx_lq_deviation = 0; //sum of distances from ShortCount/LongCount
+static uint16_t rx_lq_pulses = 0; //number of pulses in rx_lq_deviation
+static uint8_t rx_lq_margin = 0; //smallest distance to the edge of the windows
+static uint8_t rx_lq_glitches = 0; //samples rejected by the filter
+
+// and of the completed packets, one per buffer of the double buffered receive
+static uint16_t lq_deviation[2];
+static uint16_t lq_pulses[2];
+static uint8_t lq_margin[2];
+static uint8_t lq_glitches[2];
+
+static uint16_t rx_maxBytes = 2;
 static uint8_t rx_default_data[2];
 static uint8_t* rx_data = rx_default_data;
 
+// streaming receive, every byte is handed to rx_consumer instead of rx_data
+static ManchesterConsumer rx_consumer = 0;
+static uint16_t rx_streamLength = 0;
+
+// double buffered receive, the ISR is the only writer of rx_head and the
+// main loop is the only writer of rx_tail so no critical sections are needed
+volatile static uint8_t rx_double = 0;
+volatile static uint8_t rx_head = 0; //packets completed by the ISR
+volatile static uint8_t rx_tail = 0; //packets released by the main loop
+static uint8_t rx_capacity = 0;
+static uint8_t* rx_buffers[2];
+
+// automatic speed detection, the timer runs at rx_speedFactor and slower
+// transmissions are measured with a smaller rx_step
+volatile static uint8_t rx_auto = 0;
+volatile static uint8_t rx_speedFactor = MAN_1200;
+volatile static uint8_t rx_shift = 0; //how many speed factors below rx_speedFactor we locked on
+static uint8_t lq_shift[2]; //rx_shift of the completed packets, like lq_deviation
+
+#if DECOUPLING_PN9
+// Return the next whitening byte and advance the PN9 sequence by 8 bits.
+// The 8 new bits are n[k] = s[k] ^ s[k+5], for k >= 4 s[k+5] is itself one
+// of the new bits, so we compute the low and high nibble separately instead
+// of stepping the LFSR 8 times.
+static inline uint8_t NextPN9(uint16_t *s)
+{
+  uint8_t out = *s;
+  uint8_t n = *s ^ (*s >> 5);
+  n = (n & 0x0F) | ((out ^ (n << 4)) & 0xF0);
+  *s = (*s >> 8) | ((uint16_t)n << 1);
+  return out;
+}
+#endif
+
 Manchester::Manchester() //constructor
 {
   applyWorkAround1Mhz = 0;
+  carrierSense = 0;
+  txPN9 = PN9_SEED;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    secureKey[i] = 0;
+  }
 }
 
 
@@ -108,6 +169,19 @@ void Manchester::setupReceive(uint8_t pin, uint8_t SF)
 }
 
 
+void Manchester::setupReceiveAuto(uint8_t pin, uint8_t maxSF)
+{
+  setRxPin(pin);
+  ::MANRX_SetupReceiveAuto(maxSF);
+}
+
+
+uint8_t Manchester::getReceiveSpeed(void)
+{
+  return ::MANRX_GetSpeedFactor();
+}
+
+
 void Manchester::setup(uint8_t Tpin, uint8_t Rpin, uint8_t SF)
 {
   setupTransmit(Tpin, SF);
@@ -140,7 +214,61 @@ The receiver is then operating correctly and we have locked onto the transmissio
 */
 void Manchester::transmitArray(uint8_t numBytes, uint8_t *data)
 {
+  if (carrierSense)
+  {
+    waitForClearChannel();
+  }
 
+  sendPreamble();
+  // Send the user data
+  for (uint8_t i = 0; i < numBytes; i++)
+  {
+    sendByte(data[i]);
+  }
+  sendTrailer();
+}//end of send the data
+
+/*
+Streams are sent like arrays but with a 16 bit length in the first two bytes
+(low byte first), the length includes these two bytes. The data is pulled
+from the producer one byte ahead while transmitting, each call is made in
+the second half of the last bit of the byte before, see sendStreamByte().
+*/
+uint8_t Manchester::transmitStream(uint16_t numBytes, ManchesterProducer producer)
+{
+  if (numBytes > STREAM_MAX_BYTES)
+  {
+    return 0;
+  }
+  if (carrierSense)
+  {
+    waitForClearChannel();
+  }
+
+  uint16_t length = numBytes + 2;
+  uint8_t data = 0;
+  if (numBytes > 0)
+  {
+    data = producer(0); //nothing is on air yet, this one can take its time
+  }
+  sendPreamble();
+  sendByte(length);
+  sendByte(length >> 8);
+  for (uint16_t i = 0; i + 1 < numBytes; i++)
+  {
+    data = sendStreamByte(data, producer, i + 1);
+  }
+  if (numBytes > 0)
+  {
+    sendByte(data);
+  }
+  sendTrailer();
+  return 1;
+}
+
+
+void Manchester::sendPreamble(void)
+{
 #if SYNC_BIT_VALUE
   for( int8_t i = 0; i < SYNC_PULSE_DEF; i++) //send capture pulses
   {
@@ -154,22 +282,33 @@ void Manchester::transmitArray(uint8_t numBytes, uint8_t *data)
   }
   sendOne(); //start data pulse
 #endif
- 
-  // Send the user data
-  for (uint8_t i = 0; i < numBytes; i++)
+#if DECOUPLING_PN9
+  txPN9 = PN9_SEED;
+#endif
+}
+
+
+void Manchester::sendByte(uint8_t data)
+{
+  uint16_t mask = 0x01; //mask to send bits
+#if DECOUPLING_PN9
+  uint8_t d = data ^ NextPN9(&txPN9);
+#else
+  uint8_t d = data ^ DECOUPLING_MASK;
+#endif
+  for (uint8_t j = 0; j < 8; j++)
   {
-    uint16_t mask = 0x01; //mask to send bits
-    uint8_t d = data[i] ^ DECOUPLING_MASK;
-    for (uint8_t j = 0; j < 8; j++)
-    {
-      if ((d & mask) == 0)
-        sendZero();
-      else
-        sendOne();
-      mask <<= 1; //get next bit
-    }//end of byte
-  }//end of data
+    if ((d & mask) == 0)
+      sendZero();
+    else
+      sendOne();
+    mask <<= 1; //get next bit
+  }//end of byte
+}
+
 
+void Manchester::sendTrailer(void)
+{
   // Send 3 terminatings 0's to correctly terminate the previous bit and to turn the transmitter off
 #if SYNC_BIT_VALUE
   sendOne();
@@ -180,7 +319,115 @@ void Manchester::transmitArray(uint8_t numBytes, uint8_t *data)
   sendZero();
   sendZero();
 #endif
-}//end of send the data
+}
+
+
+void Manchester::listenBeforeTalk(uint8_t a)
+{
+  carrierSense = a;
+  ::MANRX_SetCarrierSense(a);
+  if (a)
+  {
+    //identical nodes powered up together would draw the same backoff and
+    //collide again, so seed random() from the receiver, whose output is
+    //noise while nobody transmits, and the time we were called
+    uint32_t seed = micros();
+    for (uint8_t i = 0; i < 32; i++)
+    {
+      seed = (seed << 1) ^ (seed >> 31) ^ digitalRead(::RxPin);
+      delayMicroseconds(37);
+    }
+    randomSeed(seed ^ micros());
+  }
+}
+
+
+uint8_t Manchester::channelBusy(void)
+{
+  return ::MANRX_ChannelBusy();
+}
+
+/*
+Many transmitters sharing one channel will collide, since each of them keys
+the radio whenever it likes. With carrier sense enabled we first listen for
+LBT_LISTEN_BITS bit intervals, if the receiver sees manchester activity we
+back off for 1 to 2, then 1 to 4, 1 to 8, ... slots and try again. After
+LBT_MAX_ATTEMPTS busy attempts we give up waiting and transmit anyway so that
+the data is not lost.
+*/
+void Manchester::waitForClearChannel(void)
+{
+  for (uint8_t attempt = 0; attempt < LBT_MAX_ATTEMPTS; attempt++)
+  {
+    uint8_t busy = 0;
+    for (uint8_t i = 0; (i < LBT_LISTEN_BITS) && !busy; i++)
+    {
+      busy = ::MANRX_ChannelBusy();
+      delayMicroseconds(delay1 + delay2);
+    }
+    if (!busy)
+    {
+      return;
+    }
+    if (attempt == LBT_MAX_ATTEMPTS - 1)
+    {
+      //out of attempts, a backoff we don't listen after would only add delay
+      return;
+    }
+
+    //random backoff of 1 to 2^(attempt+1) slots
+    uint16_t slots = random(1, (2L << attempt) + 1);
+    for (uint16_t s = 0; s < slots; s++)
+    {
+      for (uint8_t i = 0; i < LBT_SLOT_BITS; i++)
+      {
+        delayMicroseconds(delay1 + delay2);
+      }
+    }
+  }
+}
+/*
+sendByte for streams, the producer is asked for byte next after the mid-bit
+transition of the last bit and the time it took is taken off the rest of
+that bit. This leaves the producer half a bit, calling it between two bytes
+would stretch the bit boundary by the whole producer time.
+*/
+uint8_t Manchester::sendStreamByte(uint8_t data, ManchesterProducer producer, uint16_t next)
+{
+#if DECOUPLING_PN9
+  uint8_t d = data ^ NextPN9(&txPN9);
+#else
+  uint8_t d = data ^ DECOUPLING_MASK;
+#endif
+  for (uint8_t j = 0; j < 7; j++)
+  {
+    if ((d & 1) == 0)
+      sendZero();
+    else
+      sendOne();
+    d >>= 1; //get next bit
+  }
+
+  //last bit, like sendZero/sendOne with the producer in its second half
+  delayMicroseconds(delay1);
+  digitalWrite(TxPin, d ? LOW : HIGH);
+
+  uint16_t start = micros();
+  uint8_t nextData = producer(next);
+  uint16_t spent = (uint16_t)micros() - start;
+#if F_CPU == 1000000UL
+  if (applyWorkAround1Mhz)
+  {
+    spent >>= 3; //delays are divided by 8 too
+  }
+#endif
+  if (spent < delay2)
+  {
+    delayMicroseconds(delay2 - spent);
+  }
+  digitalWrite(TxPin, d ? HIGH : LOW);
+  return nextData;
+}
 
 
 void Manchester::sendZero(void)
@@ -234,11 +481,299 @@ uint16_t Manchester::encodeMessage(uint8_t id, uint8_t data)
   return m;
 }
 
+/*
+    batch versions of encodeMessage/decodeMessage
+    
+    MAN_CHECKSUM_XOR is the checksum of encodeMessage, the xor of all four
+    nibbles is 0b0011 for a correct message.
+    
+    MAN_CHECKSUM_CRC4 replaces the checksum nibble with CRC-4-ITU over the
+    ID and data nibbles, computed with a 16 entry nibble table. The result
+    is xored with 0b0011 like the xor checksum so that a message of all
+    zeroes (a dead or stuck transmitter) is not valid.
+*/
+static const uint8_t crc4Table[16] = {
+  0x0, 0x3, 0x6, 0x5, 0xC, 0xF, 0xA, 0x9, 0xB, 0x8, 0xD, 0xE, 0x7, 0x4, 0x1, 0x2
+};
+
+static uint8_t crc4(uint8_t id, uint8_t data)
+{
+  uint8_t crc = crc4Table[id & 0b1111];
+  crc = crc4Table[crc ^ (data >> 4)];
+  return crc4Table[crc ^ (data & 0b1111)] ^ 0b0011;
+}
+
+void Manchester::encodeMessages(uint8_t count, const uint8_t *ids, const uint8_t *data, uint16_t *messages, uint8_t checksum)
+{
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t chsum;
+    if (checksum == MAN_CHECKSUM_CRC4)
+    {
+      chsum = crc4(ids[i], data[i]);
+    }
+    else
+    {
+      chsum = (ids[i] ^ data[i] ^ (data[i] >> 4) ^ 0b0011) & 0b1111;
+    }
+    messages[i] = ((uint16_t)ids[i] << 12) | ((uint16_t)chsum << 8) | data[i];
+  }
+}
+
+//fill ids[], data[] and the validity bitmap, inlined once for each checksum
+//so the choice is not made per message
+static inline uint8_t decodeAllMessages(uint8_t count, const uint16_t *messages, uint8_t *ids, uint8_t *data, uint8_t *valid, uint8_t checksum)
+{
+  uint8_t numValid = 0;
+  uint8_t bits = 0;
+  uint8_t mask = 1; //bit of message i in its valid[] byte
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint16_t m = messages[i];
+    uint8_t id = m >> 12;
+    uint8_t d = m;
+    uint8_t ch = (m >> 8) & 0b1111; //checksum received
+    uint8_t ech; //checksum expected
+    if (checksum == MAN_CHECKSUM_CRC4)
+    {
+      ech = crc4(id, d);
+    }
+    else
+    {
+      ech = (id ^ d ^ (d >> 4) ^ 0b0011) & 0b1111;
+    }
+    ids[i] = id;
+    data[i] = d;
+    if (ch == ech)
+    {
+      bits |= mask;
+      numValid++;
+    }
+    mask <<= 1;
+    if (mask == 0)
+    {
+      *valid++ = bits;
+      bits = 0;
+      mask = 1;
+    }
+  }
+  if (mask != 1)
+  {
+    *valid = bits;
+  }
+  return numValid;
+}
+
+uint8_t Manchester::decodeMessages(uint8_t count, const uint16_t *messages, uint8_t *ids, uint8_t *data, uint8_t *valid, uint8_t checksum)
+{
+  if (checksum == MAN_CHECKSUM_CRC4)
+  {
+    return decodeAllMessages(count, messages, ids, data, valid, MAN_CHECKSUM_CRC4);
+  }
+  return decodeAllMessages(count, messages, ids, data, valid, MAN_CHECKSUM_XOR);
+}
+
+/*
+    authenticated encryption of array packets
+    
+    [len][ counter ][   encrypted payload   ][   tag   ]
+    [ 0 ][1 ... 4  ][5 ... len-5            ][len-4 ...]
+    
+    The block cipher is Speck64/128, it needs no tables and is fast on 8 bit
+    microcontrollers. It is used in CCM mode: the payload is encrypted in
+    counter mode and authenticated with a CBC-MAC truncated to 32 bits.
+    The counter is the nonce, it has to grow with every packet sent with the
+    same key and the receiver rejects counters it has already seen.
+    
+    The counter must survive a reset of the transmitter. Starting again from
+    0 reuses the counter mode keystream, which gives away the xor of two
+    plaintexts, and the receiver drops every packet until the old counter is
+    passed. Keep it in EEPROM, to save EEPROM writes store counter + N every
+    N packets and start from the stored value after a reset, skipping at
+    most N counters.
+*/
+#define SPECK_ROUNDS 27
+#define SECURE_CTR_BLOCK 0x01000000UL //domain of the counter mode blocks
+#define SECURE_MAC_BLOCK 0x02000000UL //domain of the first CBC-MAC block
+
+static uint32_t loadWord(const uint8_t *b)
+{
+  return ((uint32_t)b[0]) | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void storeWord(uint8_t *b, uint32_t w)
+{
+  b[0] = w;
+  b[1] = w >> 8;
+  b[2] = w >> 16;
+  b[3] = w >> 24;
+}
+
+//encrypt 8 bytes in place, the round keys are computed on the fly so that
+//we don't need 108 bytes of RAM for the key schedule
+static void speckEncrypt(const uint32_t *key, uint8_t *block)
+{
+  uint32_t x = loadWord(block);
+  uint32_t y = loadWord(block + 4);
+  uint32_t k = key[0];
+  uint32_t l[3] = {key[1], key[2], key[3]};
+  uint8_t j = 0;
+  for (uint8_t i = 0; i < SPECK_ROUNDS; i++)
+  {
+    x = ((x >> 8) | (x << 24)) + y;
+    x ^= k;
+    y = ((y << 3) | (y >> 29)) ^ x;
+    //next round key
+    l[j] = (k + ((l[j] >> 8) | (l[j] << 24))) ^ i;
+    k = ((k << 3) | (k >> 29)) ^ l[j];
+    if (++j == 3)
+    {
+      j = 0;
+    }
+  }
+  storeWord(block, x);
+  storeWord(block + 4, y);
+}
+
+static void secureBlock(const uint32_t *key, uint8_t *block, uint32_t counter, uint32_t domain)
+{
+  storeWord(block, counter);
+  storeWord(block + 4, domain);
+  speckEncrypt(key, block);
+}
+
+void Manchester::setSecureKey(const uint8_t *key)
+{
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    secureKey[i] = loadWord(key + 4 * i);
+  }
+}
+
+//encrypt and sign data into packet, packet must have room for numBytes + SECURE_OVERHEAD bytes
+uint8_t Manchester::encodeSecureArray(uint8_t numBytes, const uint8_t *data, uint8_t *packet, uint32_t &counter)
+{
+  if (numBytes > SECURE_MAX_PAYLOAD)
+  {
+    return 0;
+  }
+  counter++;
+  packet[0] = numBytes + SECURE_OVERHEAD;
+  storeWord(packet + 1, counter);
+
+  uint8_t mac[8];
+  uint8_t stream[8];
+  secureBlock(secureKey, mac, counter, SECURE_MAC_BLOCK | numBytes);
+  uint8_t *out = packet + 5;
+  for (uint8_t i = 0; i < numBytes; i += 8)
+  {
+    secureBlock(secureKey, stream, counter, SECURE_CTR_BLOCK | ((i >> 3) + 1));
+    for (uint8_t j = 0; (j < 8) && (i + j < numBytes); j++)
+    {
+      mac[j] ^= data[i + j];
+      out[i + j] = data[i + j] ^ stream[j];
+    }
+    speckEncrypt(secureKey, mac);
+  }
+
+  //the tag is encrypted with counter block 0
+  secureBlock(secureKey, stream, counter, SECURE_CTR_BLOCK);
+  for (uint8_t j = 0; j < 4; j++)
+  {
+    out[numBytes + j] = mac[j] ^ stream[j];
+  }
+  return packet[0];
+}
+
+//verify and decrypt packet into data, packetBytes is the size of the receive buffer holding
+//packet and maxBytes the size of data, the length byte came over the air so it is checked
+//against both before anything is read or written
+uint8_t Manchester::decodeSecureArray(const uint8_t *packet, uint8_t packetBytes, uint8_t *data, uint8_t maxBytes, uint8_t &numBytes, uint32_t &lastCounter)
+{
+  numBytes = 0;
+  if ((packetBytes < SECURE_OVERHEAD) ||
+      (packet[0] < SECURE_OVERHEAD) ||
+      (packet[0] > packetBytes) ||
+      (packet[0] - SECURE_OVERHEAD > maxBytes))
+  {
+    return 0;
+  }
+  uint32_t counter = loadWord(packet + 1);
+  if (counter <= lastCounter)
+  {
+    return 0; //replayed or out of date
+  }
+  uint8_t len = packet[0] - SECURE_OVERHEAD;
+
+  uint8_t mac[8];
+  uint8_t stream[8];
+  secureBlock(secureKey, mac, counter, SECURE_MAC_BLOCK | len);
+  const uint8_t *in = packet + 5;
+  for (uint8_t i = 0; i < len; i += 8)
+  {
+    secureBlock(secureKey, stream, counter, SECURE_CTR_BLOCK | ((i >> 3) + 1));
+    for (uint8_t j = 0; (j < 8) && (i + j < len); j++)
+    {
+      data[i + j] = in[i + j] ^ stream[j];
+      mac[j] ^= data[i + j];
+    }
+    speckEncrypt(secureKey, mac);
+  }
+
+  secureBlock(secureKey, stream, counter, SECURE_CTR_BLOCK);
+  uint8_t diff = 0;
+  for (uint8_t j = 0; j < 4; j++)
+  {
+    diff |= in[len + j] ^ mac[j] ^ stream[j];
+  }
+  if (diff)
+  {
+    for (uint8_t i = 0; i < len; i++)
+    {
+      data[i] = 0; //don't leave unauthenticated plaintext around
+    }
+    return 0;
+  }
+  lastCounter = counter;
+  numBytes = len;
+  return 1;
+}
+
 void Manchester::beginReceiveArray(uint8_t maxBytes, uint8_t *data)
 {
   ::MANRX_BeginReceiveBytes(maxBytes, data);
 }
 
+void Manchester::beginReceiveDoubleArray(uint8_t maxBytes, uint8_t *data0, uint8_t *data1)
+{
+  ::MANRX_BeginReceiveDoubleBytes(maxBytes, data0, data1);
+}
+
+uint8_t *Manchester::getReceivedArray(void)
+{
+  return ::MANRX_GetReceivedBytes();
+}
+
+void Manchester::releaseReceivedArray(void)
+{
+  ::MANRX_ReleaseReceivedBytes();
+}
+
+void Manchester::beginReceiveStream(ManchesterConsumer consumer)
+{
+  ::MANRX_BeginReceiveStream(consumer);
+}
+
+uint8_t Manchester::getLinkQuality(void)
+{
+  return ::MANRX_GetLinkQuality();
+}
+
+void Manchester::getLinkStats(uint8_t &deviation, uint8_t &margin, uint8_t &glitches)
+{
+  ::MANRX_GetLinkStats(&deviation, &margin, &glitches);
+}
+
 void Manchester::beginReceive(void)
 {
   ::MANRX_BeginReceive();
@@ -269,8 +804,33 @@ void Manchester::stopReceive(void)
    void timer0_ISR (void);
 #endif
 
+void MANRX_SetupReceiveAuto(uint8_t maxSpeedFactor)
+{
+  MANRX_SetupReceive(maxSpeedFactor);
+  // carrier sense has to accept pulses of the slowest speed too
+  uint8_t slowest = (maxSpeedFactor < 3) ? maxSpeedFactor : 3;
+  rx_cs_max = MaxLongCount >> (3 - slowest);
+  rx_cs_slowest = slowest;
+  rx_auto = 1;
+}
+
+uint8_t MANRX_GetSpeedFactor(void)
+{
+  uint8_t slot = rx_double ? (rx_tail & 1) : 0;
+  return rx_speedFactor - lq_shift[slot];
+}
+
 void MANRX_SetupReceive(uint8_t speedFactor)
 {
+  rx_auto = 0;
+  rx_step = 8;
+  rx_cs_max = MaxLongCount >> 3;
+  rx_cs_slowest = 0;
+  rx_cs_speed = 0;
+  rx_shift = 0;
+  lq_shift[0] = 0;
+  lq_shift[1] = 0;
+  rx_speedFactor = speedFactor;
   pinMode(RxPin, INPUT);
   //setup timers depending on the microcontroller used
 
@@ -446,8 +1006,25 @@ void MANRX_SetupReceive(uint8_t speedFactor)
 
 } //end of setupReceive
 
+// Keep the ISR away from the receive state. A stream the consumer has seen
+// the start of will never finish now, so it is told the stream is aborted.
+static void IdleReceive(void)
+{
+  noInterrupts();
+  uint8_t abort = rx_consumer && (rx_mode == RX_MODE_DATA) && (rx_curByte > 2);
+  rx_mode = RX_MODE_IDLE;
+  interrupts();
+  if (abort)
+  {
+    rx_consumer(STREAM_ABORT, 0);
+  }
+}
+
 void MANRX_BeginReceive(void)
 {
+  IdleReceive(); //keep the ISR away while we set up
+  rx_consumer = 0;
+  rx_double = 0;
   rx_maxBytes = 2;
   rx_data = rx_default_data;
   rx_mode = RX_MODE_PRE;
@@ -455,27 +1032,124 @@ void MANRX_BeginReceive(void)
 
 void MANRX_BeginReceiveBytes(uint8_t maxBytes, uint8_t *data)
 {
+  IdleReceive(); //keep the ISR away while we set up
+  rx_consumer = 0;
+  rx_double = 0;
   rx_maxBytes = maxBytes;
   rx_data = data;
   rx_mode = RX_MODE_PRE;
 }
 
+void MANRX_BeginReceiveDoubleBytes(uint8_t maxBytes, uint8_t *data0, uint8_t *data1)
+{
+  IdleReceive(); //keep the ISR away while we set up
+  rx_consumer = 0;
+  rx_capacity = maxBytes;
+  rx_maxBytes = maxBytes;
+  rx_buffers[0] = data0;
+  rx_buffers[1] = data1;
+  rx_data = data0;
+  rx_head = 0;
+  rx_tail = 0;
+  rx_double = 1;
+  rx_mode = RX_MODE_PRE;
+}
+
+void MANRX_BeginReceiveStream(ManchesterConsumer consumer)
+{
+  IdleReceive(); //keep the ISR away while we set up
+  rx_double = 0;
+  rx_maxBytes = 2; //the length, the rest is known once we have it
+  rx_consumer = consumer;
+  rx_mode = RX_MODE_PRE;
+}
+
+uint8_t* MANRX_GetReceivedBytes(void)
+{
+  return rx_buffers[rx_tail & 1];
+}
+
+void MANRX_ReleaseReceivedBytes(void)
+{
+  if (rx_head != rx_tail)
+  {
+    rx_tail++;
+  }
+}
+
 void MANRX_StopReceive(void)
 {
-  rx_mode = RX_MODE_IDLE;
+  IdleReceive();
 }
 
 uint8_t MANRX_ReceiveComplete(void)
 {
+  if (rx_double)
+  {
+    return (rx_head != rx_tail);
+  }
   return (rx_mode == RX_MODE_MSG);
 }
 
+void MANRX_SetCarrierSense(uint8_t enable)
+{
+  rx_cs_pulses = 0;
+  rx_cs_enabled = enable;
+}
+
+uint8_t MANRX_ChannelBusy(void)
+{
+  return (rx_mode == RX_MODE_DATA) || (rx_cs_pulses >= CS_PULSE_MIN);
+}
+
 uint8_t MANRX_GetMessage(void)
 {
   return (((int16_t)rx_data[0]) << 8) | (int16_t)rx_data[1];
 }
 
 
+void MANRX_GetLinkStats(uint8_t *deviation, uint8_t *margin, uint8_t *glitches)
+{
+  uint8_t slot = rx_double ? (rx_tail & 1) : 0;
+  *deviation = lq_pulses[slot] ? (lq_deviation[slot] / lq_pulses[slot]) : 0;
+  *margin = lq_margin[slot];
+  *glitches = lq_glitches[slot];
+}
+
+/*
+The link quality is 100 for a perfect packet. Pulses are only measured to
+the nearest sample (8 counts), so a perfect link still shows some deviation
+and may come within one sample of the window edges.
+
+The quality drops with the average distance of the pulses from ShortCount or
+LongCount, where the distance ShortCount - MinCount counts as 0. If any pulse
+came closer than one sample to the edge of its window it is also limited by
+that margin, and it loses 5 for every glitch the sampling filter removed.
+*/
+uint8_t MANRX_GetLinkQuality(void)
+{
+  uint8_t slot = rx_double ? (rx_tail & 1) : 0;
+  if (lq_pulses[slot] == 0)
+  {
+    return 0;
+  }
+  
+  uint8_t full = ShortCount - MinCount;
+  uint32_t loss = (uint32_t)lq_deviation[slot] * 100 / ((uint32_t)lq_pulses[slot] * full);
+  uint8_t quality = (loss >= 100) ? 0 : (100 - loss);
+  
+  uint8_t reserve = full - 8; //margin left when a pulse is one sample off
+  if (lq_margin[slot] < reserve)
+  {
+    uint8_t marginQuality = (uint16_t)lq_margin[slot] * 100 / reserve;
+    if (marginQuality < quality)
+      quality = marginQuality;
+  }
+  
+  uint16_t penalty = (uint16_t)lq_glitches[slot] * 5;
+  return (penalty >= quality) ? 0 : (quality - penalty);
+}
+
 void MANRX_SetRxPin(uint8_t pin)
 {
   RxPin = pin;
@@ -483,7 +1157,7 @@ void MANRX_SetRxPin(uint8_t pin)
 }//end of set transmit pin
 
 void AddManBit(uint16_t *manBits, uint8_t *numMB,
-               uint8_t *curByte, uint8_t *data,
+               uint16_t *curByte, uint8_t *data,
                uint8_t bit)
 {
   *manBits <<= 1;
@@ -502,13 +1176,46 @@ void AddManBit(uint16_t *manBits, uint8_t *numMB,
       newData |= (*manBits & 1); // store the one
       *manBits = *manBits >> 2; //get next data bit
     }
-    data[*curByte] = newData ^ DECOUPLING_MASK;
+#if DECOUPLING_PN9
+    newData ^= NextPN9(&rx_pn9);
+#else
+    newData ^= DECOUPLING_MASK;
+#endif
+
+    if (rx_consumer)
+    {
+      // Streams start with a 16 bit length, low byte first
+      if (*curByte == 0)
+      {
+        rx_streamLength = newData;
+      }
+      else if (*curByte == 1)
+      {
+        rx_streamLength |= (uint16_t)newData << 8;
+        rx_maxBytes = rx_streamLength;
+        if (rx_streamLength < 2)
+        {
+          // the length counts itself, this is a false lock
+          rx_mode = RX_MODE_PRE;
+        }
+      }
+      else
+      {
+        rx_consumer(*curByte - 2, newData);
+      }
+      (*curByte)++;
+      *numMB = 0;
+      return;
+    }
+
+    data[*curByte] = newData;
     (*curByte)++;
 
     // added by caoxp @ https://github.com/caoxp
     // compatible with unfixed-length data, with the data length defined by the first byte.
 	// at a maximum of 255 total data length.
-    if( (*curByte) == 1)
+    // a false lock gives a random length, never go past the buffer
+    if( ((*curByte) == 1) && (data[0] < rx_maxBytes) )
     {
       rx_maxBytes = data[0];
     }
@@ -517,6 +1224,34 @@ void AddManBit(uint16_t *manBits, uint8_t *numMB,
   }
 }
 
+// Keep the link quality and speed of a completed packet until the application
+// reads it, the ISR may already be trying to lock on the next one
+static void SavePacketInfo(uint8_t slot)
+{
+  lq_shift[slot] = rx_shift;
+  lq_deviation[slot] = rx_lq_deviation;
+  lq_pulses[slot] = rx_lq_pulses;
+  lq_margin[slot] = rx_lq_margin;
+  lq_glitches[slot] = rx_lq_glitches;
+}
+
+// Start receiving into the next free buffer of the double buffered receive.
+// Called from the ISR only, if both buffers are waiting for the main loop we
+// stay in RX_MODE_MSG until one of them is released.
+static void NextRxBuffer(void)
+{
+  if ((uint8_t)(rx_head - rx_tail) < 2)
+  {
+    rx_data = rx_buffers[rx_head & 1];
+    rx_maxBytes = rx_capacity;
+    rx_mode = RX_MODE_PRE;
+  }
+  else
+  {
+    rx_mode = RX_MODE_MSG;
+  }
+}
+
 
 
 #if defined( ESP8266 )
@@ -533,10 +1268,20 @@ ISR(TIMER3_COMPA_vect)
 ISR(TIMER2_COMPA_vect)
 #endif
 {
-  if (rx_mode < RX_MODE_MSG) //receiving something
+  if (rx_double && (rx_mode == RX_MODE_MSG))
+  {
+    // Both buffers were full, check if the main loop released one
+    NextRxBuffer();
+  }
+
+  if ((rx_mode < RX_MODE_MSG) || rx_cs_enabled) //receiving something or sensing the carrier
   {
-    // Increment counter
-    rx_count += 8;
+    // Increment counter, stop at 255 so that a long silence can't wrap
+    // around into a valid pulse width
+    if (rx_count <= 255 - rx_step)
+    {
+      rx_count += rx_step;
+    }
     
     // Check for value change
     //rx_sample = digitalRead(RxPin);
@@ -550,11 +1295,61 @@ ISR(TIMER2_COMPA_vect)
     {
       rx_sample = rx_sample_1;
     }
+    else if( (rx_sample_1 == rx_sample) && (rx_mode == RX_MODE_DATA) &&
+             (rx_lq_glitches < 255) )
+    {
+      // the previous sample was a single sample spike that the filter dropped
+      rx_lq_glitches++;
+    }
     rx_sample_0 = rx_sample_1;
 
 
     //check sample transition
     uint8_t transition = (rx_sample != rx_last_sample);
+
+    if (rx_cs_enabled)
+    {
+      // Carrier sense, count transitions that are spaced like manchester
+      // pulses using the same windows as RX_MODE_SYNC. The time is kept in
+      // samples, a single pulse at the timer speed is MinCount / 8 samples
+      // and a double pulse at the slowest speed we receive is rx_cs_max.
+      if (rx_cs_count <= rx_cs_max)
+      {
+        rx_cs_count++;
+      }
+      if (transition)
+      {
+        if (rx_cs_pulses == 0)
+        {
+          // The first pulse picks the speed like RX_MODE_SYNC picks rx_shift,
+          // the rest of the run must match it. Noise easily fits the union
+          // of all the auto-baud windows, it rarely sticks to one of them.
+          rx_cs_speed = 0;
+          while ((rx_cs_count > (MaxLongCount >> (3 - rx_cs_speed))) && (rx_cs_speed < rx_cs_slowest))
+          {
+            rx_cs_speed++;
+          }
+        }
+        if ((rx_cs_count >= ((MinCount + (7 >> rx_cs_speed)) >> (3 - rx_cs_speed))) &&
+            (rx_cs_count <= (MaxLongCount >> (3 - rx_cs_speed))))
+        {
+          if (rx_cs_pulses < 255)
+          {
+            rx_cs_pulses++;
+          }
+        }
+        else
+        {
+          rx_cs_pulses = 0;
+        }
+        rx_cs_count = 0;
+      }
+      else if (rx_cs_count > (MaxLongCount >> (3 - rx_cs_speed)))
+      {
+        // No transition for too long, the carrier is gone
+        rx_cs_pulses = 0;
+      }
+    }
   
     if (rx_mode == RX_MODE_PRE)
     {
@@ -564,6 +1359,11 @@ ISR(TIMER2_COMPA_vect)
         rx_count = 0;
         rx_sync_count = 0;
         rx_mode = RX_MODE_SYNC;
+        if (rx_auto)
+        {
+          // Measure the first pulse in samples to find the speed
+          rx_step = 1;
+        }
       }
     }
     else if (rx_mode == RX_MODE_SYNC)
@@ -571,6 +1371,27 @@ ISR(TIMER2_COMPA_vect)
       // Initial sync block
       if (transition)
       {
+        if (rx_auto && (rx_sync_count == 0))
+        {
+          // The first pulse is a single pulse, at rx_shift speed factors
+          // below the timer speed it lasts 6 << rx_shift samples, pick the
+          // rx_shift that brings it into MinCount..MaxCount and count
+          // 8 >> rx_shift per sample from now on
+          uint8_t samples = rx_count;
+          if (samples <= (MaxCount >> 3))
+            rx_shift = 0;
+          else if (samples <= (MaxCount >> 2))
+            rx_shift = 1;
+          else if (samples <= (MaxCount >> 1))
+            rx_shift = 2;
+          else
+            rx_shift = 3;
+          if (rx_shift > rx_speedFactor)
+            rx_shift = rx_speedFactor; //can't go slower than MAN_300
+          rx_step = 8 >> rx_shift;
+          uint16_t count = (uint16_t)samples * rx_step;
+          rx_count = (count > 255) ? 255 : count;
+        }
         if( ( (rx_sync_count < (SYNC_PULSE_MIN * 2) )  || (rx_last_sample == 1)  ) &&
             ( (rx_count < MinCount) || (rx_count > MaxCount)))
         {
@@ -601,6 +1422,11 @@ ISR(TIMER2_COMPA_vect)
             rx_manBits = 0;
             rx_numMB   = 0;
             rx_curByte = 0;
+            rx_pn9     = PN9_SEED;
+            rx_lq_deviation = 0;
+            rx_lq_pulses    = 0;
+            rx_lq_margin    = 255;
+            rx_lq_glitches  = 0;
           }
           else if (rx_sync_count >= (SYNC_PULSE_MAX * 2) )
           {
@@ -620,17 +1446,71 @@ ISR(TIMER2_COMPA_vect)
         {
           // wrong signal lenght, discard the message
           rx_mode = RX_MODE_PRE;
+          if (rx_consumer && (rx_curByte > 2))
+          {
+            // the consumer has seen the start of this stream
+            rx_consumer(STREAM_ABORT, 0);
+          }
         }
         else
         {
+          // Link quality, how far is the pulse from its nominal width and
+          // from the edges of the window it fell into
+          uint8_t deviation;
+          uint8_t margin;
+          if(rx_count >= MinLongCount)
+          {
+            deviation = (rx_count > LongCount) ? (rx_count - LongCount) : (LongCount - rx_count);
+            margin = rx_count - MinLongCount;
+            if ((uint8_t)(MaxLongCount - rx_count) < margin)
+              margin = MaxLongCount - rx_count;
+          }
+          else
+          {
+            deviation = (rx_count > ShortCount) ? (rx_count - ShortCount) : (ShortCount - rx_count);
+            margin = rx_count - MinCount;
+            if ((uint8_t)(MaxCount - rx_count) < margin)
+              margin = MaxCount - rx_count;
+          }
+          if (margin < rx_lq_margin)
+            rx_lq_margin = margin;
+          if ((rx_lq_deviation >= 0xFF00) || (rx_lq_pulses >= 0xFF00))
+          {
+            // keep the average, just forget some of the history
+            rx_lq_deviation >>= 1;
+            rx_lq_pulses >>= 1;
+          }
+          rx_lq_deviation += deviation;
+          rx_lq_pulses++;
+
           if(rx_count >= MinLongCount) // was the previous bit a double bit?
           {
             AddManBit(&rx_manBits, &rx_numMB, &rx_curByte, rx_data, rx_last_sample);
           }
-          if ((rx_sample == 1) &&
+          if (rx_mode != RX_MODE_DATA)
+          {
+            // AddManBit found a stream length that can't be right
+          }
+          else if ((rx_sample == 1) &&
               (rx_curByte >= rx_maxBytes))
           {
-            rx_mode = RX_MODE_MSG;
+            if (rx_double)
+            {
+              // Hand the buffer over and carry on with the other one
+              SavePacketInfo(rx_head & 1);
+              rx_head++;
+              NextRxBuffer();
+            }
+            else
+            {
+              SavePacketInfo(0);
+              rx_mode = RX_MODE_MSG;
+              if (rx_consumer && (rx_curByte > 2))
+              {
+                // only a stream the consumer has seen the start of
+                rx_consumer(STREAM_END, 0);
+              }
+            }
           }
           else
           {
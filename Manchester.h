@@ -104,6 +104,8 @@ allowing us to transmit even with up to 100% in clock speed difference
 #define MaxCount        65  //pulse higher count limit on capture
 #define MinLongCount    66  //pulse lower count on double pulse
 #define MaxLongCount    129 //pulse higher count on double pulse
+#define ShortCount      48  //nominal single pulse, used for the link quality
+#define LongCount       96  //nominal double pulse, used for the link quality
 
 //setup timing for transmitter
 #define HALF_BIT_INTERVAL 3072 //(=48 * 1024 * 1000000 / 16000000Hz) microseconds for speed factor 0 (300baud)
@@ -113,6 +115,44 @@ allowing us to transmit even with up to 100% in clock speed difference
 //therefore we xor the data with random decoupling mask
 #define DECOUPLING_MASK 0b11001010 
 
+//a fixed mask still sends repeated patterns for repeated bytes, set this to 1
+//to whiten the data with the PN9 sequence (x^9 + x^5 + 1) instead, like
+//commercial sub-GHz radios do, restarted at the beginning of every packet.
+//this changes what goes on air, both ends must be built with the same setting
+#define DECOUPLING_PN9 0
+#define PN9_SEED 0x1FF
+
+//listen before talk, used when carrier sense is enabled with listenBeforeTalk()
+//the channel is considered busy after this many consecutive transitions with
+//a valid manchester pulse width (MinCount..MaxLongCount) at one speed.
+//noise that fits the windows by chance still looks busy some of the time, with
+//random levels each sample the channel reads busy 4.3% of the time at 4 pulses
+//and 0.2% at 8, a real transmitter is detected within 8 bits either way
+#define CS_PULSE_MIN 8
+#define LBT_LISTEN_BITS 8   //bit intervals the channel must stay clear before we transmit
+#define LBT_SLOT_BITS 32    //bit intervals in one backoff slot
+#define LBT_MAX_ATTEMPTS 6  //backoff window doubles on each busy attempt, after the last one we transmit anyway
+//worst case transmitArray()/transmitStream() wait before sending is
+//LBT_MAX_ATTEMPTS * LBT_LISTEN_BITS + (2^LBT_MAX_ATTEMPTS - 2) * LBT_SLOT_BITS = 2032 bit intervals,
+//0.39s at MAN_9600, 3.1s at MAN_1200 and 12.5s at MAN_300
+
+//checksum of the 16 bit ID+data message used by encodeMessages/decodeMessages
+#define MAN_CHECKSUM_XOR 0  //same as encodeMessage/decodeMessage
+#define MAN_CHECKSUM_CRC4 1 //CRC-4-ITU (x^4 + x + 1) xored with 0b0011, misses far fewer 2 bit errors
+
+//authenticated encryption of array packets, see encodeSecureArray()
+//a packet is [length][4 byte counter][encrypted payload][4 byte tag]
+//the counter passed to encodeSecureArray must never repeat for the same key, so the
+//transmitter has to keep it across resets (e.g. in EEPROM), never restart it from 0
+#define SECURE_OVERHEAD 9
+#define SECURE_MAX_PAYLOAD (255 - SECURE_OVERHEAD)
+
+//streams carry a 16 bit length that includes its own two bytes
+#define STREAM_MAX_BYTES (65535 - 2)
+//indices passed to a ManchesterConsumer after the last byte of a stream
+#define STREAM_END 0xFFFF   //all bytes were received
+#define STREAM_ABORT 0xFFFE //reception broke off, no more bytes will come
+
 #define RX_MODE_PRE 0
 #define RX_MODE_SYNC 1
 #define RX_MODE_DATA 2
@@ -128,6 +168,18 @@ allowing us to transmit even with up to 100% in clock speed difference
   #include <pins_arduino.h>
 #endif
 
+//return byte number index of the stream being transmitted, called while the last
+//bit of the previous byte is sent so it has to return within half a bit:
+//HALF_BIT_INTERVAL >> SF microseconds, 384 at MAN_1200 and 96 at MAN_9600, less the
+//time digitalWrite takes. anything longer stretches that bit and the receiver may lose it
+typedef uint8_t (*ManchesterProducer)(uint16_t index);
+//take byte number index of the stream being received, called from the interrupt so
+//it has to be quick, index 0 means a new stream has started. a stream that has
+//started ends with index STREAM_END or STREAM_ABORT, data is 0 for both, stopping or
+//restarting the receiver aborts it too. an empty stream makes no calls,
+//receiveComplete() still reports it
+typedef void (*ManchesterConsumer)(uint16_t index, uint8_t data);
+
 class Manchester
 {
   public:
@@ -139,16 +191,37 @@ class Manchester
     void setupTransmit(uint8_t pin, uint8_t SF = MAN_1200); //set up transmission
     void setupReceive(uint8_t pin, uint8_t SF = MAN_1200); //set up receiver
     void setup(uint8_t Tpin, uint8_t Rpin, uint8_t SF = MAN_1200); //set up receiver
+    void setupReceiveAuto(uint8_t pin, uint8_t maxSF = MAN_9600); //set up receiver for any speed from maxSF down to maxSF-3
+    uint8_t getReceiveSpeed(void); //speed factor of the received message
     
     void transmit(uint8_t data); //transmit 16 bits of data
     void transmitArray(uint8_t numBytes, uint8_t *data); // transmit array of bytes
+    uint8_t transmitStream(uint16_t numBytes, ManchesterProducer producer); // transmit bytes from producer, return 0 if longer than STREAM_MAX_BYTES, see ManchesterProducer for its time limit
+    void listenBeforeTalk(uint8_t a = 1); //wait for a clear channel before transmitting, up to 3.1s at MAN_1200 (see LBT_MAX_ATTEMPTS), receiver must be set up, seeds random() from receiver noise
+    uint8_t channelBusy(void); //true if the receiver currently sees manchester activity
     
     uint8_t decodeMessage(uint16_t m, uint8_t &id, uint8_t &data); //decode 8 bit payload and 4 bit ID from the message, return 1 of checksum is correct, otherwise 0
     uint16_t encodeMessage(uint8_t id, uint8_t data); //encode 8 bit payload, 4 bit ID and 4 bit checksum into 16 bit
     
+    //encode count messages from ids[] and data[] into messages[]
+    void encodeMessages(uint8_t count, const uint8_t *ids, const uint8_t *data, uint16_t *messages, uint8_t checksum = MAN_CHECKSUM_XOR);
+    //decode count messages into ids[] and data[], bit i of valid[] is set if message i is correct, return number of correct messages
+    //valid[] must hold (count + 7) / 8 bytes
+    uint8_t decodeMessages(uint8_t count, const uint16_t *messages, uint8_t *ids, uint8_t *data, uint8_t *valid, uint8_t checksum = MAN_CHECKSUM_XOR);
+    
+    void setSecureKey(const uint8_t *key); //set the 16 byte key for encodeSecureArray and decodeSecureArray
+    uint8_t encodeSecureArray(uint8_t numBytes, const uint8_t *data, uint8_t *packet, uint32_t &counter); //encrypt and sign data into packet for transmitArray, return packet length or 0 if too long
+    uint8_t decodeSecureArray(const uint8_t *packet, uint8_t packetBytes, uint8_t *data, uint8_t maxBytes, uint8_t &numBytes, uint32_t &lastCounter); //verify and decrypt a packet from a packetBytes receive buffer into maxBytes of data, return 1 if authentic and not replayed, otherwise 0
+    
     //wrappers for global functions
     void beginReceive(void);
     void beginReceiveArray(uint8_t maxBytes, uint8_t *data);
+    void beginReceiveDoubleArray(uint8_t maxBytes, uint8_t *data0, uint8_t *data1); //keep receiving while the application reads the other buffer
+    uint8_t *getReceivedArray(void); //oldest completed buffer of the double buffered receive
+    void releaseReceivedArray(void); //done with getReceivedArray(), the ISR may fill it again
+    void beginReceiveStream(ManchesterConsumer consumer); //pass every byte of a stream to consumer
+    uint8_t getLinkQuality(void); //0..100 link quality of the received message, from its pulse timing
+    void getLinkStats(uint8_t &deviation, uint8_t &margin, uint8_t &glitches); //average pulse deviation and worst window margin in counts, filtered glitches
     uint8_t receiveComplete(void);
     uint8_t getMessage(void);
     void stopReceive(void);
@@ -159,8 +232,16 @@ class Manchester
   private:
     void sendZero(void);
     void sendOne(void);
+    void sendPreamble(void);
+    void sendByte(uint8_t data);
+    uint8_t sendStreamByte(uint8_t data, ManchesterProducer producer, uint16_t next);
+    void sendTrailer(void);
+    void waitForClearChannel(void);
     uint8_t TxPin;
     uint8_t applyWorkAround1Mhz;
+    uint8_t carrierSense;
+    uint32_t secureKey[4];
+    uint16_t txPN9; //whitening sequence state
 };//end of class Manchester
 
 // Cant really do this as a real C++ class, since we need to have
@@ -173,20 +254,51 @@ extern "C"
     //begin the timer used to receive data
     extern void MANRX_SetupReceive(uint8_t speedFactor = MAN_1200);
     
+    //begin the timer at maxSpeedFactor and detect the speed of each transmission
+    //down to 8 times slower, the interrupt runs at the rate of maxSpeedFactor
+    extern void MANRX_SetupReceiveAuto(uint8_t maxSpeedFactor = MAN_9600);
+    
+    // speed factor of the received message
+    extern uint8_t MANRX_GetSpeedFactor(void);
+    
     // begin receiving 16 bits
     extern void MANRX_BeginReceive(void);
     
     // begin receiving a byte array
     extern void MANRX_BeginReceiveBytes(uint8_t maxBytes, uint8_t *data);
     
+    // begin receiving byte arrays alternately into two buffers
+    extern void MANRX_BeginReceiveDoubleBytes(uint8_t maxBytes, uint8_t *data0, uint8_t *data1);
+    
+    // begin receiving a stream, each byte is passed to consumer from the interrupt
+    extern void MANRX_BeginReceiveStream(ManchesterConsumer consumer);
+    
+    // oldest completed buffer of the double buffered receive
+    extern uint8_t* MANRX_GetReceivedBytes(void);
+    
+    // give the buffer from MANRX_GetReceivedBytes back to the receiver
+    extern void MANRX_ReleaseReceivedBytes(void);
+    
     // true if a complete message is ready
     extern uint8_t MANRX_ReceiveComplete(void);
     
     // fetch the received message
     extern uint8_t MANRX_GetMessage(void);
     
+    // link quality 0..100 of the received message
+    extern uint8_t MANRX_GetLinkQuality(void);
+    
+    // pulse timing statistics of the received message, in counts of 48 per pulse
+    extern void MANRX_GetLinkStats(uint8_t *deviation, uint8_t *margin, uint8_t *glitches);
+    
     // stop receiving data
     extern void MANRX_StopReceive(void);
+    
+    // keep sampling the channel for carrier sense even when not receiving
+    extern void MANRX_SetCarrierSense(uint8_t enable);
+    
+    // true if valid looking manchester transitions are on the channel
+    extern uint8_t MANRX_ChannelBusy(void);
 }
 
 extern Manchester man;
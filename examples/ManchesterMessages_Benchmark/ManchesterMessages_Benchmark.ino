@@ -0,0 +1,80 @@
+#include "Manchester.h"
+
+/*
+
+  Manchester batch messages benchmark
+  
+  Measures how long decodeMessages takes per message with both checksums,
+  against calling decodeMessage for each message, on this microcontroller
+  and prints it over Serial in microseconds and CPU cycles.
+
+  For comparison a 16 bit message takes 32 half bits on the air, that is
+  3072 us at MAN_9600 or about 49000 cycles at 16Mhz.
+
+*/
+
+#define COUNT 64
+#define ROUNDS 20
+
+uint8_t ids[COUNT];
+uint8_t data[COUNT];
+uint16_t xorMessages[COUNT];
+uint16_t crcMessages[COUNT];
+uint8_t valid[(COUNT + 7) / 8];
+
+void printResult(const char *name, unsigned long us, unsigned long numValid)
+{
+  unsigned long messages = (unsigned long)COUNT * ROUNDS;
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((float)us / messages);
+  Serial.print(" us/message, ");
+  Serial.print((float)us * (F_CPU / 1000000UL) / messages);
+  Serial.print(" cycles/message, ");
+  Serial.print(numValid / ROUNDS);
+  Serial.println(" valid");
+}
+
+void setup() 
+{
+  Serial.begin(19200);
+  for (uint8_t i = 0; i < COUNT; i++)
+  {
+    ids[i] = i & 0b1111;
+    data[i] = i * 37;
+  }
+  man.encodeMessages(COUNT, ids, data, xorMessages, MAN_CHECKSUM_XOR);
+  man.encodeMessages(COUNT, ids, data, crcMessages, MAN_CHECKSUM_CRC4);
+  //flip a checksum bit of every fourth message so both outcomes of the check are timed
+  for (uint8_t i = 0; i < COUNT; i += 4)
+  {
+    xorMessages[i] ^= 0x0100;
+    crcMessages[i] ^= 0x0100;
+  }
+}
+
+void loop() 
+{
+  unsigned long numValid = 0;
+  unsigned long start = micros();
+  for (uint8_t r = 0; r < ROUNDS; r++)
+  {
+    for (uint8_t i = 0; i < COUNT; i++)
+      numValid += man.decodeMessage(xorMessages[i], ids[i], data[i]);
+  }
+  printResult("decodeMessage loop", micros() - start, numValid);
+
+  numValid = 0;
+  start = micros();
+  for (uint8_t r = 0; r < ROUNDS; r++)
+    numValid += man.decodeMessages(COUNT, xorMessages, ids, data, valid, MAN_CHECKSUM_XOR);
+  printResult("decodeMessages xor", micros() - start, numValid);
+
+  numValid = 0;
+  start = micros();
+  for (uint8_t r = 0; r < ROUNDS; r++)
+    numValid += man.decodeMessages(COUNT, crcMessages, ids, data, valid, MAN_CHECKSUM_CRC4);
+  printResult("decodeMessages crc4", micros() - start, numValid);
+
+  delay(2000);
+}
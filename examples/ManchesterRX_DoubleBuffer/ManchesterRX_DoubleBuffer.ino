@@ -0,0 +1,62 @@
+
+#include "Manchester.h"
+
+/*
+
+  Manchester Receiver example
+  
+  In this example receiver will receive arrays of bytes into two buffers,
+  while we print one buffer the receiver keeps filling the other one so
+  packets sent back to back are not lost
+
+  try different speeds using this constants, your maximum possible speed will 
+  depend on various factors like transmitter type, distance, microcontroller speed, ...
+
+  MAN_300 0
+  MAN_600 1
+  MAN_1200 2
+  MAN_2400 3
+  MAN_4800 4
+  MAN_9600 5
+  MAN_19200 6
+  MAN_38400 7
+
+*/
+
+#define RX_PIN 4
+#define LED_PIN 13
+
+uint8_t moo = 1;
+#define BUFFER_SIZE 22
+uint8_t buffer0[BUFFER_SIZE];
+uint8_t buffer1[BUFFER_SIZE];
+
+void setup() 
+{
+  pinMode(LED_PIN, OUTPUT);  
+  digitalWrite(LED_PIN, moo);
+  Serial.begin(19200);
+  man.setupReceive(RX_PIN, MAN_9600);
+  man.beginReceiveDoubleArray(BUFFER_SIZE, buffer0, buffer1);
+}
+
+void loop() 
+{
+  if (man.receiveComplete()) 
+  {
+    uint8_t *buffer = man.getReceivedArray();
+    uint8_t receivedSize = buffer[0];
+    //the length comes from the air, the receiver never writes past BUFFER_SIZE
+    if (receivedSize > BUFFER_SIZE)
+      receivedSize = BUFFER_SIZE;
+    for(uint8_t i=1; i<receivedSize; i++)
+      Serial.write(buffer[i]);
+    
+    Serial.println();
+
+    //no need to start receiving again, just hand the buffer back
+    man.releaseReceivedArray();
+    moo = ++moo % 2;
+    digitalWrite(LED_PIN, moo);
+  }
+}
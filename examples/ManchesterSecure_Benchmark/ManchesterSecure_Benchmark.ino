@@ -0,0 +1,66 @@
+
+#include "Manchester.h"
+
+/*
+
+  Manchester secure packets benchmark
+  
+  Measures how long encodeSecureArray and decodeSecureArray take per payload
+  byte on this microcontroller and prints it over Serial in microseconds and
+  CPU cycles.
+
+  For comparison a byte takes 16 half bits on the air, that is 1536 us at
+  MAN_9600 or about 24500 cycles at 16Mhz.
+
+*/
+
+#define PAYLOAD_SIZE 64
+#define ROUNDS 20
+
+uint8_t key[16] = {0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0a, 0x0b,
+                   0x10, 0x11, 0x12, 0x13, 0x18, 0x19, 0x1a, 0x1b};
+uint8_t payload[PAYLOAD_SIZE];
+uint8_t packet[PAYLOAD_SIZE + SECURE_OVERHEAD];
+uint8_t decoded[PAYLOAD_SIZE];
+
+void printResult(const char *name, unsigned long us)
+{
+  unsigned long bytes = (unsigned long)PAYLOAD_SIZE * ROUNDS;
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((float)us / bytes);
+  Serial.print(" us/byte, ");
+  Serial.print((float)us * (F_CPU / 1000000UL) / bytes);
+  Serial.println(" cycles/byte");
+}
+
+void setup() 
+{
+  Serial.begin(19200);
+  man.setSecureKey(key);
+  for (uint8_t i = 0; i < PAYLOAD_SIZE; i++)
+    payload[i] = i;
+}
+
+void loop() 
+{
+  uint32_t counter = 0;
+  unsigned long start = micros();
+  for (uint8_t r = 0; r < ROUNDS; r++)
+    man.encodeSecureArray(PAYLOAD_SIZE, payload, packet, counter);
+  printResult("encode", micros() - start);
+
+  uint8_t numBytes;
+  uint8_t ok = 1;
+  start = micros();
+  for (uint8_t r = 0; r < ROUNDS; r++)
+  {
+    uint32_t lastCounter = 0; //accept the same packet every round
+    ok &= man.decodeSecureArray(packet, sizeof(packet), decoded, sizeof(decoded), numBytes, lastCounter);
+  }
+  printResult("decode", micros() - start);
+  if (!ok)
+    Serial.println("decode failed");
+
+  delay(2000);
+}
@@ -0,0 +1,45 @@
+/*
+    Host stand-in for the Arduino core, just enough to build Manchester.cpp
+    for the ATmega328 timer 2 code path and call its ISR from a simulation.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define _BV(b) (1u << (b))
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2;
+enum { CS20 = 0, CS21 = 1, CS22 = 2, WGM21 = 1, OCIE2A = 1 };
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+void delayMicroseconds(unsigned int us);
+unsigned long micros(void);
+unsigned long millis(void);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+void noInterrupts(void);
+void interrupts(void);
+
+//the ISR becomes a plain function the simulation calls once per timer tick
+#define ISR(vector) extern "C" void vector(void); void vector(void)
+
+//simulation side, see arduino_stubs.cpp
+extern int sim_rx_level;     //what digitalRead() returns
+extern double sim_time;      //microseconds, advanced by delayMicroseconds()
+struct SimEdge { double t; uint8_t level; };
+void sim_record(SimEdge *edges, uint32_t *count, uint32_t capacity); //where digitalWrite() goes
+
+#endif
@@ -0,0 +1,72 @@
+/*
+    Host implementation of the Arduino functions Manchester.cpp uses.
+    Transmitting records the output as timed edges instead of driving a pin,
+    receiving reads sim_rx_level.
+*/
+#include "Arduino.h"
+
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2;
+
+int sim_rx_level = 0;
+double sim_time = 0;
+
+static SimEdge *recEdges = 0;
+static uint32_t *recCount = 0;
+static uint32_t recCapacity = 0;
+
+void sim_record(SimEdge *edges, uint32_t *count, uint32_t capacity)
+{
+  recEdges = edges;
+  recCount = count;
+  recCapacity = capacity;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+int digitalRead(uint8_t)
+{
+  return sim_rx_level;
+}
+
+void digitalWrite(uint8_t, uint8_t level)
+{
+  if (recEdges && (*recCount < recCapacity))
+  {
+    recEdges[*recCount].t = sim_time;
+    recEdges[*recCount].level = level;
+    (*recCount)++;
+  }
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  sim_time += us;
+}
+
+unsigned long micros(void)
+{
+  return (unsigned long)sim_time;
+}
+
+unsigned long millis(void)
+{
+  return (unsigned long)(sim_time / 1000);
+}
+
+long random(long howBig)
+{
+  return rand() % howBig;
+}
+
+long random(long howSmall, long howBig)
+{
+  return howSmall + rand() % (howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+  srand(seed);
+}
+
+void noInterrupts(void) {}
+void interrupts(void) {}
@@ -0,0 +1,263 @@
+/*
+    Simulation of N nodes sharing one channel, with and without listen
+    before talk, that reports the aggregate delivery rate at a gateway.
+
+    This is a host program, not a sketch. It builds the library against the
+    stand-in Arduino core in this directory and drives the receive ISR one
+    timer tick at a time:
+
+      g++ -O2 -DARDUINO=100 -I extras/simulation -I . \
+          extras/simulation/lbt_nodes.cpp extras/simulation/arduino_stubs.cpp \
+          Manchester.cpp -o lbt_nodes
+
+      ./lbt_nodes                              the table for 2 to 40 nodes
+      ./lbt_nodes nodes lbt [gap s] [run s] [seed]   a single run
+
+    Every node sends a 10 byte array at MAN_1200 (about 134ms on air) after
+    an exponentially distributed gap, 5s on average. The channel is the OR
+    of all transmitters, like on-off keyed radios on one frequency.
+
+    1. The channel is fed into the library with carrier sense on, while it
+       is idle otherwise. Its channelBusy() is what every node hears, so
+       there are no hidden nodes. With lbt each node runs the same steps as
+       waitForClearChannel(): listen LBT_LISTEN_BITS bits, on a busy channel
+       back off 1..2^(attempt+1) slots of LBT_SLOT_BITS bits and listen
+       again, transmit anyway after LBT_MAX_ATTEMPTS busy attempts.
+    2. The recorded channel is replayed into a double buffered receiver,
+       a packet counts as delivered if it arrives intact.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <set>
+#include <vector>
+#include "Manchester.h"
+
+extern "C" void TIMER2_COMPA_vect(void);
+
+#define TICK_US 128.0 //timer 2 at MAN_1200 and 16MHz
+#define BIT_US 1536.0 //one bit at MAN_1200
+#define PACKET_BYTES 10
+#define MAX_EDGES 512
+
+enum { NODE_WAIT, NODE_LISTEN, NODE_BACKOFF, NODE_SEND };
+
+struct Node
+{
+  uint8_t state;
+  double next; //time of the next step
+  uint8_t attempt;
+  uint8_t bitsLeft;
+  uint16_t seq;
+  SimEdge edges[MAX_EDGES];
+  uint32_t numEdges;
+  uint32_t edge;
+  uint8_t level;
+  double end;
+};
+
+struct Result
+{
+  long sent;
+  long delivered;
+};
+
+static void fillPacket(uint8_t *packet, uint8_t id, uint16_t seq)
+{
+  packet[0] = PACKET_BYTES;
+  packet[1] = id;
+  packet[2] = seq >> 8;
+  packet[3] = seq;
+  for (uint8_t i = 4; i < PACKET_BYTES; i++)
+  {
+    packet[i] = id * 31 + seq + i;
+  }
+}
+
+static void startSending(Node &n, uint8_t id, double now, std::set<long> &sent)
+{
+  uint8_t packet[PACKET_BYTES];
+  fillPacket(packet, id, n.seq);
+  sent.insert((long)id << 16 | n.seq);
+  n.seq++;
+  n.numEdges = 0;
+  sim_time = now;
+  sim_record(n.edges, &n.numEdges, MAX_EDGES);
+  man.transmitArray(PACKET_BYTES, packet);
+  sim_record(0, 0, 0);
+  n.end = sim_time;
+  n.edge = 0;
+  n.level = 0;
+  n.state = NODE_SEND;
+}
+
+static Result simulate(int numNodes, int lbt, double meanGap, double duration, int seed)
+{
+  std::mt19937 rng(seed);
+  std::exponential_distribution<double> gap(1.0 / meanGap);
+  std::vector<Node> nodes(numNodes);
+  std::vector<SimEdge> channel;
+  std::set<long> sent;
+
+  man.setupTransmit(5, MAN_1200);
+  man.setupReceive(4, MAN_1200);
+  man.stopReceive();
+  MANRX_SetCarrierSense(1);
+  for (int k = 0; k < numNodes; k++)
+  {
+    memset(&nodes[k], 0, sizeof(Node));
+    nodes[k].next = gap(rng);
+  }
+
+  uint8_t lastLevel = 0;
+  for (double t = 0; t < duration; t += TICK_US)
+  {
+    //the channel is on while any node sends a high level
+    uint8_t level = 0;
+    for (int k = 0; k < numNodes; k++)
+    {
+      Node &n = nodes[k];
+      if (n.state != NODE_SEND)
+        continue;
+      while ((n.edge < n.numEdges) && (n.edges[n.edge].t <= t))
+      {
+        n.level = n.edges[n.edge].level;
+        n.edge++;
+      }
+      if (t >= n.end)
+      {
+        n.state = NODE_WAIT;
+        n.next = t + gap(rng);
+      }
+      else
+      {
+        level |= n.level;
+      }
+    }
+    if (level != lastLevel)
+    {
+      SimEdge e = { t, level };
+      channel.push_back(e);
+      lastLevel = level;
+    }
+    sim_rx_level = level;
+    TIMER2_COMPA_vect();
+
+    for (int k = 0; k < numNodes; k++)
+    {
+      Node &n = nodes[k];
+      if ((n.state == NODE_SEND) || (t < n.next))
+        continue;
+      if (n.state == NODE_WAIT)
+      {
+        if (!lbt)
+        {
+          startSending(n, k, t, sent);
+          continue;
+        }
+        n.attempt = 0;
+        n.bitsLeft = LBT_LISTEN_BITS;
+        n.state = NODE_LISTEN;
+      }
+      else if (n.state == NODE_BACKOFF)
+      {
+        n.attempt++;
+        n.bitsLeft = LBT_LISTEN_BITS;
+        n.state = NODE_LISTEN;
+      }
+
+      //one check per bit, like waitForClearChannel()
+      if (man.channelBusy())
+      {
+        if (n.attempt == LBT_MAX_ATTEMPTS - 1)
+        {
+          startSending(n, k, t, sent);
+          continue;
+        }
+        long slots = 1 + rng() % (2L << n.attempt);
+        n.state = NODE_BACKOFF;
+        n.next = t + slots * LBT_SLOT_BITS * BIT_US;
+      }
+      else if (--n.bitsLeft == 0)
+      {
+        startSending(n, k, t, sent);
+      }
+      else
+      {
+        n.next = t + BIT_US;
+      }
+    }
+  }
+
+  //the gateway
+  MANRX_SetCarrierSense(0);
+  uint8_t buffer0[PACKET_BYTES + 10];
+  uint8_t buffer1[PACKET_BYTES + 10];
+  man.beginReceiveDoubleArray(sizeof(buffer0), buffer0, buffer1);
+  std::set<long> delivered;
+  size_t edge = 0;
+  for (double t = 0; t < duration + 5000; t += TICK_US)
+  {
+    while ((edge < channel.size()) && (channel[edge].t <= t))
+    {
+      sim_rx_level = channel[edge].level;
+      edge++;
+    }
+    TIMER2_COMPA_vect();
+    if (man.receiveComplete())
+    {
+      uint8_t *b = man.getReceivedArray();
+      uint8_t expected[PACKET_BYTES];
+      uint16_t seq = (b[2] << 8) | b[3];
+      fillPacket(expected, b[1], seq);
+      long id = (long)b[1] << 16 | seq;
+      if ((memcmp(b, expected, PACKET_BYTES) == 0) && sent.count(id))
+      {
+        delivered.insert(id);
+      }
+      man.releaseReceivedArray();
+    }
+  }
+  man.stopReceive();
+  sim_rx_level = 0;
+
+  Result r = { (long)sent.size(), (long)delivered.size() };
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 3)
+  {
+    int numNodes = atoi(argv[1]);
+    int lbt = atoi(argv[2]);
+    double meanGap = (argc > 3) ? atof(argv[3]) : 5;
+    double duration = (argc > 4) ? atof(argv[4]) : 600;
+    int seed = (argc > 5) ? atoi(argv[5]) : 1;
+    Result r = simulate(numNodes, lbt, meanGap * 1e6, duration * 1e6, seed);
+    printf("nodes %d lbt %d: %ld/%ld delivered %.1f%%\n",
+           numNodes, lbt, r.delivered, r.sent, 100.0 * r.delivered / r.sent);
+    return 0;
+  }
+
+  //600s with a 5s mean gap, three seeds added up
+  static const int sizes[] = { 2, 5, 10, 20, 40 };
+  printf("nodes  without lbt            with lbt\n");
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    Result total[2] = { { 0, 0 }, { 0, 0 } };
+    for (int lbt = 0; lbt < 2; lbt++)
+    {
+      for (int seed = 1; seed <= 3; seed++)
+      {
+        Result r = simulate(sizes[i], lbt, 5e6, 600e6, seed);
+        total[lbt].sent += r.sent;
+        total[lbt].delivered += r.delivered;
+      }
+    }
+    printf("%5d  %5ld/%-5ld %5.1f%%     %5ld/%-5ld %5.1f%%\n", sizes[i],
+           total[0].delivered, total[0].sent, 100.0 * total[0].delivered / total[0].sent,
+           total[1].delivered, total[1].sent, 100.0 * total[1].delivered / total[1].sent);
+  }
+  return 0;
+}